@@ -4,15 +4,20 @@
 ADS_set.h - Samuel Sulovsky
 */
 #include <functional>
+#include <atomic>
 #include <algorithm>
 #include <iostream>
 #include <stdexcept>
+#include <type_traits>
+#include <cstdint>
 #include <vector>
+#include <new>
 
-template <typename Key, size_t N = 18> // N = bucketsize
+template <typename Key, size_t N = 18, bool Compact = false, bool Prefilter = false> // N = bucketsize, Compact = store integral keys as quotients, Prefilter = Bloom filter per row
 class ADS_set {
 public:
   class Iterator;
+  class Snapshot;
   using value_type = Key;
   using key_type = Key;
   using reference = key_type &;
@@ -27,55 +32,388 @@ public:
 
 private:
 
+  // Compact sets hash integral keys with the identity function, which is invertible:
+  // the low bits of a key are implied by the row it is stored in, so only the
+  // remaining quotient bits have to be stored (see CompactBucket)
+  static constexpr bool compact {Compact};
+  static_assert(!compact || (std::is_integral<key_type>::value && !std::is_same<key_type, bool>::value 
+                             && sizeof(key_type) <= sizeof(size_type)), "Compact requires an integral key type");
+
+  // Sets with Prefilter keep a Bloom filter in the first Bucket of every row, so most
+  // unsuccessful lookups don't have to scan the row (see RowFilter)
+  static constexpr bool prefilter {Prefilter};
+
+  // Hash value of a key, keys of compact sets are used as their own hash value
+  static size_type code(const key_type &key) 
+  { 
+    if constexpr (compact) return static_cast<size_type>(static_cast<std::make_unsigned_t<key_type>>(key));
+    else return hasher{}(key);
+  }
+
   // Bucket class to hold data
-  class Bucket
+  class PlainBucket
   {
     public:
+      static constexpr size_type maxKeys {N}; // most keys a bucket holds
       key_type contents[N]; // Static array for data to be saved in the bucket
       size_type currentBucketSize; // Number of occupied slots in the bucket
-      Bucket* overflowBucket {nullptr};
-      Bucket() {currentBucketSize = 0;}
-      ~Bucket()
+      PlainBucket* overflowBucket {nullptr};
+      PlainBucket() {currentBucketSize = 0;}
+      PlainBucket(const PlainBucket &other) : currentBucketSize {other.currentBucketSize}
+      {
+        std::copy(other.contents, other.contents+currentBucketSize, contents);
+        // Recursively copy overflow Buckets
+        if(other.overflowBucket != nullptr) overflowBucket = new PlainBucket(*other.overflowBucket);
+      }
+      ~PlainBucket()
+      { 
+        // Recursively delete overflow Buckets
+        if(this->overflowBucket != nullptr) delete this->overflowBucket;
+      }
+
+      // Access functions shared with CompactBucket
+      // the row and number of low bits (shift) of the Bucket's row are only used by CompactBucket
+      const key_type &get(size_type i, size_type, size_type) const { return contents[i]; }
+      const key_type* slot(size_type i) const { return contents+i; }
+      int index(const key_type &key, size_type) const // position of key in the bucket, -1 if not stored
+      {
+        for(size_type i {0}; i < currentBucketSize; ++i)
+        {
+          if(key_equal{}(contents[i], key)) return i;
+        }
+        return -1;
+      }
+      bool accepts(const key_type &, size_type) const { return currentBucketSize < N; }
+      void push(const key_type &key, size_type) { contents[currentBucketSize++] = key; }
+      void remove(size_type i)
+      {
+        for(++i; i < currentBucketSize; ++i)
+        {
+          contents[i-1] = contents[i];
+        }
+        --currentBucketSize;
+      }
+  };
+
+  // Bucket class to hold integral keys in quotient form
+  // Every key in a row a has its low depth(a) bits equal to a, so only key >> depth(a) is stored.
+  // The Bucket does not store its row, the caller passes it (and the shift depth(a)) to the access functions.
+  // The quotients are bit-packed with the width of the largest one, so the bucket
+  // takes the same memory as N keys but can hold more of them when the quotients are small.
+  // The number of keys is capped at maxKeys, so rows stay short enough to scan.
+  class CompactBucket
+  {
+    public:
+      static constexpr size_type numWords {(N*sizeof(key_type) + 7) / 8}; // memory of N keys, in 64 bit words
+      static constexpr size_type maxKeys {2*N}; // most keys a bucket holds, however small the quotients
+      std::uint64_t words[numWords] {}; // Static array of packed quotients
+      std::uint32_t currentBucketSize; // Number of occupied slots in the bucket
+      std::uint32_t width {1}; // bits per stored quotient
+      CompactBucket* overflowBucket {nullptr};
+      CompactBucket() : currentBucketSize {0} {}
+      CompactBucket(const CompactBucket &other) : currentBucketSize {other.currentBucketSize}, width {other.width}
+      {
+        std::copy(other.words, other.words+numWords, words);
+        // Recursively copy overflow Buckets
+        if(other.overflowBucket != nullptr) overflowBucket = new CompactBucket(*other.overflowBucket);
+      }
+      ~CompactBucket()
       { 
         // Recursively delete overflow Buckets
         if(this->overflowBucket != nullptr) delete this->overflowBucket;
       }
+
+      // number of quotients of the given width that fit into the bucket
+      static size_type capacity(size_type w) { return std::min(numWords*64 / w, maxKeys); }
+
+      // number of bits needed to store quotient q
+      static size_type bits(std::uint64_t q)
+      {
+        size_type b {1};
+        if(q >> 32) { q >>= 32; b += 32; }
+        if(q >> 16) { q >>= 16; b += 16; }
+        if(q >> 8) { q >>= 8; b += 8; }
+        if(q >> 4) { q >>= 4; b += 4; }
+        if(q >> 2) { q >>= 2; b += 2; }
+        if(q >> 1) ++b;
+        return b;
+      }
+
+      // read/write the i-th quotient, packed with w bits each
+      std::uint64_t read(size_type i, size_type w) const
+      {
+        size_type pos {i*w};
+        std::uint64_t q {words[pos/64] >> (pos%64)};
+        if(numWords > 1 && pos%64 + w > 64) q |= words[pos/64 + 1] << (64 - pos%64);
+        return w == 64 ? q : q & ((std::uint64_t{1} << w) - 1);
+      }
+
+      void write(size_type i, size_type w, std::uint64_t q)
+      {
+        size_type pos {i*w};
+        std::uint64_t mask {w == 64 ? ~std::uint64_t{0} : (std::uint64_t{1} << w) - 1};
+        words[pos/64] = (words[pos/64] & ~(mask << (pos%64))) | (q << (pos%64));
+        if(numWords > 1 && pos%64 + w > 64)
+        {
+          std::uint64_t restMask {(std::uint64_t{1} << (pos%64 + w - 64)) - 1};
+          words[pos/64 + 1] = (words[pos/64 + 1] & ~restMask) | (q >> (64 - pos%64));
+        }
+      }
+
+      // Access functions shared with PlainBucket
+      key_type get(size_type i, size_type row, size_type shift) const 
+      { 
+        return static_cast<key_type>((read(i, width) << shift) | row);
+      }
+      const key_type* slot(size_type) const { return nullptr; } // keys are decoded, there is nothing to point to
+      int index(const key_type &key, size_type shift) const // compares quotients, so no key has to be decoded
+      {
+        std::uint64_t q {code(key) >> shift};
+        if(bits(q) > width) return -1;
+        for(size_type i {0}; i < currentBucketSize; ++i)
+        {
+          if(read(i, width) == q) return i;
+        }
+        return -1;
+      }
+      bool accepts(const key_type &key, size_type shift) const 
+      { 
+        return currentBucketSize < capacity(std::max<size_type>(width, bits(code(key) >> shift)));
+      }
+      void push(const key_type &key, size_type shift)
+      {
+        std::uint64_t q {code(key) >> shift};
+        size_type w {bits(q)};
+        if(w > width)
+        {
+          // repack with the wider width, back to front so no quotient is overwritten before it is moved
+          for(size_type i {currentBucketSize}; i-- > 0;)
+          {
+            write(i, w, read(i, width));
+          }
+          width = static_cast<std::uint32_t>(w);
+        }
+        write(currentBucketSize++, width, q);
+      }
+      void remove(size_type i)
+      {
+        for(++i; i < currentBucketSize; ++i)
+        {
+          write(i-1, width, read(i, width));
+        }
+        --currentBucketSize;
+      }
+  };
+
+  using Bucket = std::conditional_t<compact, CompactBucket, PlainBucket>;
+
+  // Bloom filter over all keys of a row, with about 8 bits per key a Bucket holds
+  // only the rows of sets with Prefilter have one
+  class RowFilter
+  {
+    public:
+      static constexpr size_type filterBits {(Bucket::maxKeys*8 + 63) / 64 * 64};
+      static constexpr size_type filterProbes {3};
+      std::uint64_t filter[filterBits/64] {};
+
+      // position of the j-th filter bit for the hash m, taken from the high bits (see filter_hash())
+      static size_type probe(std::uint64_t m, size_type j) { return ((m >> (48 - 16*j)) & 0xFFFF) * filterBits >> 16; }
+      void filter_add(std::uint64_t m)
+      {
+        for(size_type j {0}; j < filterProbes; ++j)
+        {
+          size_type p {probe(m, j)};
+          filter[p/64] |= std::uint64_t{1} << p%64;
+        }
+      }
+      bool filter_test(std::uint64_t m) const
+      {
+        for(size_type j {0}; j < filterProbes; ++j)
+        {
+          size_type p {probe(m, j)};
+          if(!(filter[p/64] >> p%64 & 1)) return false;
+        }
+        return true;
+      }
+      void filter_clear() { std::fill(filter, filter+filterBits/64, 0); }
+  };
+  class NoFilter {};
+  using Filter = std::conditional_t<prefilter, RowFilter, NoFilter>;
+
+  // First Bucket of a row, holds the data that is only needed once per row
+  // The overflow Buckets of the row are Buckets without a filter.
+  class Row : public Bucket, public Filter
+  {
+    public:
+      std::atomic<size_type> refs {1}; // number of tables sharing the row (see snapshot())
+      Row() = default;
+      Row(const Row &other) : Bucket(other), Filter(other) {}
   };
   
+  // Table variables, only used while the elements are stored in the table
+  // The struct has no default member initializers, it is constructed by spill() (or share())
+  // in the memory of the inline storage.
+  struct TableVars
+  {
+    Row** table; // Dynamically allocated array of rows representing the data structure
+    std::atomic<size_type>* tableRefs; // number of ADS_sets sharing the table (see snapshot())
+    size_type nextToSplit; // next Buccket to be split when necessary
+    size_type currentTableSize; // current size of the table representing the data structure (visible)
+    size_type allocSize; // current allocated size of the table representing the data structure (invisible)
+                         // used for optimisation purposes
+    std::uint32_t d; // current depth, used to determine when the table is to be expanded
+                     // also used to determine target Bucket for new data and find existing data
+    std::uint32_t pendingSplits; // splits scheduled but not carried out yet
+  };
+
+  // Small sets are kept inline in the ADS_set object itself, the table is only
+  // allocated once more than inlineCapacity elements are stored.
+  // The inline storage shares its memory with the table variables, so it holds at most
+  // as many keys as fit into them (but at least one, and no more than 8 or N).
+  static constexpr size_type inlineCapacity {std::max<size_type>(1, std::min<size_type>({N, 8, sizeof(TableVars) / sizeof(key_type)}))};
+
   // ADS_set variables
-  Bucket** table{nullptr}; // Dynamically allocated array of Buckets representing the data structure
-  size_type d {0}; // current depth, used to determine when the table is to be expanded
-                   // also used to determine target Bucket for new data and find existing data
-  size_type nextToSplit {0}; // next Buccket to be split when necessary
-  size_type currentTableSize{0}; // current size of the table representing the data structure (visible)
-  size_type allocSize {0}; // current allocated size of the table representing the data structure (invisible)
-                           // used for optimisation purposes
   size_type numElements {0}; // number of data items stored in the data structure
+  bool inlineMode {true}; // true while the elements are stored inline and the table variables are unused
+  std::uint16_t splitBudget {0}; // bounded-latency mode: scheduled splits carried out per insertion, 0 = split immediately
+  std::uint16_t maxChain {0}; // split one more row when a row has more Buckets than this, 0 = no limit
+  union
+  {
+    // inline storage, only the first numElements slots hold (constructed) keys
+    key_type inlineContents[inlineCapacity];
+    // table variables, only used while inlineMode is false
+    TableVars tab;
+  };
+
+  // number of rows in the table, 0 for small sets
+  size_type rows() const { return inlineMode ? 0 : tab.currentTableSize; }
 
   // Hash function
-  size_type h(const key_type &key, size_type d) const { return hasher{}(key) % (1ul<<d); }
+  size_type h(const key_type &key, size_type d) const { return code(key) % (1ul<<d); }
+
+  // Hash of key for the Bloom filter of its row
+  // the low bits of the hash select the row, so the filter bits are taken from the mixed high bits
+  static std::uint64_t filter_hash(const key_type &key)
+  {
+    return static_cast<std::uint64_t>(code(key)) * 0x9E3779B97F4A7C15ull;
+  }
+
+  // false if key is definitely not stored in row a
+  bool may_contain(size_type a, const key_type &key) const
+  {
+    if constexpr (prefilter) return tab.table[a]->filter_test(filter_hash(key));
+    else return true;
+  }
+
+  // Recompute the Bloom filter of row a from the keys stored in it
+  void refilter(size_type a)
+  {
+    tab.table[a]->filter_clear();
+    for(Bucket* currentBucket {tab.table[a]}; currentBucket != nullptr; currentBucket = currentBucket->overflowBucket)
+    {
+      for(size_type i {0}; i < currentBucket->currentBucketSize; ++i)
+      {
+        tab.table[a]->filter_add(filter_hash(currentBucket->get(i, a, depth(a))));
+      }
+    }
+  }
+
+  // number of low hash bits shared by all keys stored in row a
+  size_type depth(size_type a) const { return (a < tab.nextToSplit || a >= (1ul<<tab.d)) ? tab.d+1 : tab.d; }
 
   // Find functions, forward declarations
+  int find_inline(const key_type &key) const; // find position in the inline storage
   Bucket* find_(const key_type &key) const; // find 'row' in the table
   Bucket* find_ofb(const key_type &key) const; // find 'column' in the table
   // Insert functions, forward declarations
 	Bucket* insert_(const key_type &key); // standard insertion function
   Bucket* insert_noexcept(const key_type &key); // insert without raising exceptions (without splitting/rehashing the table)
+  void spill(); // move the inline elements into a newly allocated table
+
+  // Copy-on-write functions
+  // A table or row may be shared with snapshots, it has to be copied before it is modified.
+  // Drop a reference to a row, deleting it if it was the last one
+  static void release(Row* row)
+  {
+    if(row->refs.fetch_sub(1) == 1) delete row;
+  }
+
+  // Drop a reference to a table of the given size, deleting it and releasing its rows if it was the last one
+  static void release_table(Row** table, std::atomic<size_type>* tableRefs, size_type tableSize)
+  {
+    if(tableRefs->fetch_sub(1) != 1) return;
+
+    for(size_type i {0}; i < tableSize; ++i) 
+    {
+      release(table[i]);
+    }
+    delete[] table;
+    delete tableRefs;
+  }
+
+  // Make sure the table is not shared, the rows are still shared with the old table afterwards
+  void own_table()
+  {
+    if(tab.tableRefs == nullptr || *tab.tableRefs == 1) return;
+
+    Row** newTable {new Row*[tab.allocSize]};
+    for(size_type i {0}; i < tab.currentTableSize; ++i) 
+    {
+      newTable[i] = tab.table[i];
+      ++(newTable[i]->refs);
+    }
+    release_table(tab.table, tab.tableRefs, tab.currentTableSize);
+    tab.table = newTable;
+    tab.tableRefs = new std::atomic<size_type> {1};
+  }
+
+  // Share the contents of other, this ADS_set has to be empty
+  void share(const ADS_set &other)
+  {
+    numElements = other.numElements;
+    splitBudget = other.splitBudget;
+    maxChain = other.maxChain;
+
+    // small set, the inline elements are simply copied
+    if(other.inlineMode)
+    {
+      for(size_type i {0}; i < numElements; ++i)
+      {
+        new (inlineContents+i) key_type(other.inlineContents[i]);
+      }
+      return;
+    }
+
+    ++(*other.tab.tableRefs);
+    inlineMode = false;
+    new (&tab) TableVars(other.tab);
+  }
+
+  // Make sure row a is not shared, must be called after own_table()
+  void own_row(size_type a)
+  {
+    if(tab.table[a]->refs == 1) return;
+
+    Row* copy {new Row(*tab.table[a])};
+    release(tab.table[a]);
+    tab.table[a] = copy;
+  }
 
   // Rehash function without allocation. fast, but allocSize > currentTableSize necessary
   void rehash_noalloc() 
   {
     // Create new Bucket and increase visible size of the table
-    table[currentTableSize] = new Bucket;
-    ++currentTableSize;
+    tab.table[tab.currentTableSize] = new Row;
+    ++tab.currentTableSize;
     // Push contents of Bucket to be split to a vector.
     
-    Bucket* rehashBucket = table[nextToSplit];
+    Bucket* rehashBucket = tab.table[tab.nextToSplit];
+    size_type row {tab.nextToSplit}, shift {depth(row)};
     std::vector<key_type> vals {};
 
     for(size_type i {0}; i < rehashBucket->currentBucketSize; ++i) 
     {
-      vals.push_back(rehashBucket->contents[i]);
+      vals.push_back(rehashBucket->get(i, row, shift));
     }
 
     while(rehashBucket->overflowBucket != nullptr)
@@ -83,14 +421,14 @@ private:
       rehashBucket = rehashBucket->overflowBucket;
       for(size_type i {0}; i < rehashBucket->currentBucketSize; ++i) 
       {
-        vals.push_back(rehashBucket->contents[i]);
+        vals.push_back(rehashBucket->get(i, row, shift));
       }
     }
 
     // Delete the original Bucket, replace it with an empty one to be filled
-    delete table[nextToSplit];
-    table[nextToSplit] = new Bucket;
-    ++nextToSplit;
+    release(tab.table[tab.nextToSplit]);
+    tab.table[tab.nextToSplit] = new Row;
+    ++tab.nextToSplit;
 
     // Split the values between the new bucket and the original bucket
     for(auto elem : vals)  
@@ -99,44 +437,116 @@ private:
     }
   }
 
+  // Grows the table without splitting a row, so the following splits can use rehash_noalloc()
+  void grow()
+  {
+    size_type newAllocSize {static_cast<size_type>(tab.allocSize*1.3) + 1};
+    Row** newTable {new Row*[newAllocSize]};
+    std::copy(tab.table, tab.table+tab.currentTableSize, newTable);
+    delete[] tab.table;
+    tab.table = newTable;
+    tab.allocSize = newAllocSize;
+  }
+
+  // Split the next row, reallocating the table if there is no room for another row
+  void split()
+  {
+    if(tab.allocSize >= tab.currentTableSize+1) {
+      rehash_noalloc();
+    } else
+    {
+      rehash();
+    }
+
+    if(tab.nextToSplit == (1ul<<tab.d))
+    { 
+      ++tab.d;
+      tab.nextToSplit = 0;
+    };
+  }
+
+  // Split now, or in bounded-latency mode schedule the split for a later insertion
+  void split_or_schedule()
+  {
+    if(splitBudget == 0) split();
+    else ++tab.pendingSplits;
+  }
+
+  // Row a is longer than maxChain Buckets, schedule the splits up to and including row a
+  // Nothing is done if row a was already split in this round, if splitting it would not
+  // separate its keys (they all agree in the next hash bit), or if the splits would leave
+  // the table less than half full, so the table never grows faster than its contents.
+  // The splits are only scheduled, they are carried out splitBudget per insertion like all others.
+  void split_row(size_type a)
+  {
+    if(a < tab.nextToSplit || a >= (1ul<<tab.d) || tab.pendingSplits > 0) return;
+
+    size_type needed {a - tab.nextToSplit + 1};
+    if((tab.currentTableSize + needed) * N > 2 * (numElements+1)) return;
+
+    bool zero {false}, one {false};
+    for(Bucket* currentBucket {tab.table[a]}; currentBucket != nullptr; currentBucket = currentBucket->overflowBucket)
+    {
+      for(size_type i {0}; i < currentBucket->currentBucketSize; ++i)
+      {
+        if((code(currentBucket->get(i, a, depth(a))) >> tab.d) & 1) one = true;
+        else zero = true;
+      }
+    }
+    if(!zero || !one) return;
+
+    tab.pendingSplits += needed;
+  }
+
+  // Carry out up to budget scheduled splits, the table has to be owned
+  void split_pending(size_type budget)
+  {
+    for(; budget > 0 && tab.pendingSplits > 0; --budget, --tab.pendingSplits)
+    {
+      split();
+    }
+  }
+
   // Complete rehash function
   // Creates a new table with a greater memory allocation and copies all elements over
   // from the old table, then deletes it.
   void rehash()
   {
-    size_type newAllocSize {static_cast<size_type>(allocSize*1.3) + 1};
-    Bucket** newTable {new Bucket*[newAllocSize]};
-    size_type oldTableSize {currentTableSize};
-    Bucket** oldTable {table};
-    table = newTable;
-    ++currentTableSize;
-    allocSize = newAllocSize;
+    size_type newAllocSize {static_cast<size_type>(tab.allocSize*1.3) + 1};
+    Row** newTable {new Row*[newAllocSize]};
+    size_type oldTableSize {tab.currentTableSize};
+    Row** oldTable {tab.table};
+    tab.table = newTable;
+    ++tab.currentTableSize;
+    tab.allocSize = newAllocSize;
 
     // Corner case - table has size of 0 (no memory allocated so far)
     if(!oldTableSize) 
     {
-      table[0] = new Bucket;
+      tab.tableRefs = new std::atomic<size_type> {1};
+      tab.table[0] = new Row;
       return;
     }
 
     // place unaffected elements into the necessary buckets
     for (size_type index {0}; index < oldTableSize; ++index)
     {
-      if(index == nextToSplit) 
+      if(index == tab.nextToSplit) 
       {
-        table[nextToSplit] = new Bucket;
+        tab.table[tab.nextToSplit] = new Row;
         continue;
       }
       newTable[index] = oldTable[index];
     }
-    table[oldTableSize] = new Bucket;
-    Bucket* currentBucket = oldTable[nextToSplit];
-     ++nextToSplit;
+    tab.table[oldTableSize] = new Row;
+    Bucket* currentBucket = oldTable[tab.nextToSplit];
+    size_type row {tab.nextToSplit}, shift {depth(row)};
+     ++tab.nextToSplit;
 
     // rehash the split 'row' in the table
     for(size_type i {0}; i < currentBucket->currentBucketSize; ++i) 
     { 
-        insert_noexcept(currentBucket->contents[i]);
+        insert_noexcept(currentBucket->get(i, row, shift));
     }
     
     while (currentBucket->overflowBucket != nullptr)
@@ -144,12 +554,12 @@ private:
       currentBucket = currentBucket->overflowBucket;
       for(size_type i {0}; i < currentBucket->currentBucketSize; ++i) 
       {
-        insert_noexcept(currentBucket->contents[i]);
+        insert_noexcept(currentBucket->get(i, row, shift));
       }
     }
 
     // clean up
-    delete oldTable[nextToSplit-1]; 
+    release(oldTable[tab.nextToSplit-1]); 
     delete[] oldTable; 
   } 
 
@@ -162,7 +572,6 @@ public:
   ~ADS_set()
   {
     clear();
-    delete[] table;
   }
 
   ADS_set &operator=(const ADS_set &other)
@@ -170,12 +579,7 @@ public:
     if(this == &other) return *this;
 
     clear();
-
-    for(auto elem : other)
-    {
-      insert_(elem);
-      ++numElements;
-    }
+    share(other);
 
     return *this;
   }
@@ -192,7 +596,11 @@ public:
   bool empty() const { return numElements == 0; }
 
   // count number of occurences of key in the data structure
-  size_type count(const key_type &key) const { return !!find_(key); }
+  size_type count(const key_type &key) const 
+  { 
+    if(inlineMode) return find_inline(key) != -1;
+    return !!find_(key); 
+  }
 
   // Returns an iterator to element key if it's present,
   // if it isn't, return end()
@@ -202,68 +610,75 @@ public:
     // if that is the case, there's no point in looking for it
     if(!count(key)) return end();
 
+    // small set, the element is stored inline
+    if(inlineMode)
+    {
+      int i = find_inline(key);
+      return Iterator(inlineContents+i, this, nullptr, -1, i);
+    }
+
     Bucket* destBucket = nullptr;
     int row_Idx = -1;
     int ele_Idx = -1;
 
-    size_type a = h(key, d);
-    if (a < nextToSplit) a = h(key, d+1);
+    size_type a = h(key, tab.d);
+    if (a < tab.nextToSplit) a = h(key, tab.d+1);
 
-    for (size_type i {0}; i < table[a]->currentBucketSize; ++i)
+    int i = tab.table[a]->index(key, depth(a));
+    if(i != -1)
     {
-      if(key_equal{}(table[a]->contents[i], key))
-      {
-        row_Idx = a;
-        ele_Idx = i;
-        destBucket = table[a];
-      }
+      row_Idx = a;
+      ele_Idx = i;
+      destBucket = tab.table[a];
     }
 
-    Bucket* currentBucket = table[a];
+    Bucket* currentBucket = tab.table[a];
 
     while (!(currentBucket->overflowBucket == nullptr))
     {
       currentBucket = currentBucket->overflowBucket;
-      for (size_type i {0}; i < currentBucket->currentBucketSize; ++i)
+      i = currentBucket->index(key, depth(a));
+      if(i != -1)
       {
-        if(key_equal{}(currentBucket->contents[i], key))
-        {
-          row_Idx = a;
-          ele_Idx = i;
-          destBucket = currentBucket;
-        }
+        row_Idx = a;
+        ele_Idx = i;
+        destBucket = currentBucket;
       }
     }
 
-    Iterator it = Iterator(&key, this, destBucket, row_Idx, ele_Idx);
+    Iterator it = Iterator(destBucket->slot(ele_Idx), this, destBucket, row_Idx, ele_Idx);
     return it;
   }
 
   // Delete all elements from the table
   void clear()
   {
-    if(table == nullptr) return;
-  
-    for(size_type i {0}; i < currentTableSize; ++i) 
+    if(inlineMode) 
     {
-      delete table[i];
+      // inline elements are only destroyed, they need no deallocation
+      for(size_type i {0}; i < numElements; ++i)
+      {
+        inlineContents[i].~key_type();
+      }
+      numElements = 0;
+      return;
     }
 
-    delete[] table;
+    // the table is only deleted if no snapshot shares it anymore
+    release_table(tab.table, tab.tableRefs, tab.currentTableSize);
 
-    table = nullptr;
-    numElements = currentTableSize = d = allocSize = nextToSplit = 0;
+    // the table variables end here, the memory is inline storage again
+    numElements = 0;
+    inlineMode = true;
   }
   
   // Swap contents with other ADS_set
+  // copies share the table (see snapshot()), so this only copies inline elements
   void swap(ADS_set &other) 
   {
-    std::swap(table, other.table);
-    std::swap(nextToSplit, other.nextToSplit);
-    std::swap(numElements, other.numElements);
-    std::swap(allocSize, other.allocSize);
-    std::swap(d, other.d);
-    std::swap(currentTableSize, other.currentTableSize);
+    ADS_set tmp(other);
+    other = *this;
+    *this = tmp;
   }
 
   // insert the contents of an std::intialiser_list<key_type> into the table
@@ -285,7 +700,8 @@ public:
     insert_(key);
     ++numElements; 
 
-    return std::make_pair(Iterator(&key, this, find_ofb(key), find_row(key), find_idx(key)), true);
+    if(inlineMode) return std::make_pair(Iterator(inlineContents+numElements-1, this, nullptr, -1, numElements-1), true);
+    return std::make_pair(find(key), true);
   }
 
   // inserts the elements between InputIt first and InputIt last into the table
@@ -302,24 +718,36 @@ public:
   // deletes key from the table if it is present
   size_type erase(const key_type &key) 
   {
+    // small set, close the gap in the inline storage
+    if(inlineMode)
+    {
+      int pos = find_inline(key);
+      if(pos == -1) return 0;
+
+      for(size_type i {static_cast<size_type>(pos)+1}; i < numElements; ++i)
+      {
+        inlineContents[i-1] = inlineContents[i];
+      }
+      inlineContents[--numElements].~key_type();
+      return 1;
+    }
+
     if(!count(key)) return 0;
 
+    size_type a = h(key, tab.d);
+    if (a < tab.nextToSplit) a = h(key, tab.d+1);
+
+    own_table();
+    own_row(a);
+
     Bucket* currentBucket = find_ofb(key);
     if(currentBucket == nullptr) return 0;
-    bool flagMove {false};
 
-    for (size_type i {0}; i < currentBucket->currentBucketSize; ++i)
-    {
-      if(key_equal{}(currentBucket->contents[i], key)){
-        flagMove = true;
-        continue;
-      }
-      if(!flagMove) continue;
+    currentBucket->remove(currentBucket->index(key, depth(a)));
 
-      currentBucket->contents[i-1] = currentBucket->contents[i];
-    }
+    // the key may have been the only one setting some bits of the row's filter
+    if constexpr (prefilter) refilter(a);
 
-    --(currentBucket->currentBucketSize);
     --numElements;
     return 1;
   }
@@ -329,22 +757,25 @@ public:
   const_iterator begin() const
   {
     if(numElements == 0) return end();
+
+    // small set, iterate over the inline storage
+    if(inlineMode) return Iterator(inlineContents, this, nullptr, -1, 0);
     
     size_type i = 0;
 
-    Bucket* currentBucket = table[i];
+    Bucket* currentBucket = tab.table[i];
 
     while(currentBucket->currentBucketSize == 0){
         if (currentBucket->overflowBucket == nullptr) //last overflowBucket
         {
           ++i;
-          currentBucket = table[i];
+          currentBucket = tab.table[i];
         } else
         {
           currentBucket = currentBucket->overflowBucket;
         }            
     }
-    Iterator it = Iterator(currentBucket->contents, this, currentBucket, i, 0);
+    Iterator it = Iterator(currentBucket->slot(0), this, currentBucket, i, 0);
     return it;
   }
 
@@ -354,6 +785,56 @@ public:
     return Iterator(this);
   }
 
+  // Returns a read-only view of the current contents in O(1)
+  // The view shares the table and its rows with this ADS_set. Whichever side
+  // modifies a row afterwards copies that row (and once, the table of pointers to the rows) first,
+  // so the view stays unchanged while this ADS_set is written to, even from another thread.
+  // Copies of an ADS_set share their contents the same way.
+  Snapshot snapshot() const { return Snapshot(*this); }
+
+  // Bounded-latency mode
+  // Splits are no longer carried out by the insertion that causes them, but scheduled and
+  // then carried out at most splitsPerInsert per insertion, or by maintain().
+  // A row longer than maxChainLength Buckets (0 = no limit) is split as well, together with the rows
+  // before it in the split order, as long as this separates its keys and the table stays at least half full.
+  // splitsPerInsert == 0 returns to splitting immediately, catching up on all scheduled splits.
+  // maxChainLength is ignored then, the splits it needs are only carried out in bounded-latency mode.
+  // Both values are limited to 65535.
+  void set_latency_mode(size_type splitsPerInsert, size_type maxChainLength = 0)
+  {
+    splitBudget = static_cast<std::uint16_t>(std::min<size_type>(splitsPerInsert, 0xFFFF));
+    maxChain = splitBudget == 0 ? 0 : static_cast<std::uint16_t>(std::min<size_type>(maxChainLength, 0xFFFF));
+
+    if(splitBudget == 0 && !inlineMode && tab.pendingSplits > 0)
+    {
+      own_table();
+      split_pending(tab.pendingSplits);
+    }
+  }
+
+  // Carries out up to budget scheduled splits and grows the table ahead of time,
+  // once less than half of the table size is left free. Insertions only grow it when less than
+  // an eighth is left, so as long as maintain() is called regularly they never have to.
+  // Meant to be called when idle, returns the number of splits still scheduled.
+  size_type maintain(size_type budget)
+  {
+    if(inlineMode) return 0;
+
+    if(budget > 0 && tab.pendingSplits > 0)
+    {
+      own_table();
+      split_pending(budget);
+    }
+
+    if(tab.allocSize - tab.currentTableSize <= tab.currentTableSize/2)
+    {
+      own_table();
+      grow();
+    }
+
+    return tab.pendingSplits;
+  }
+
   // Dump information about the ADS_set to the specified std::ostream
   void dump(std::ostream &o = std::cerr) const;
 
@@ -361,24 +842,21 @@ public:
   int find_idx(const key_type &key) const 
   {
     if(numElements == 0) return -1; // error
+    if(inlineMode) return find_inline(key);
 
-    size_type a = h(key, d);
-    if (a < nextToSplit) a = h(key, d+1);
+    size_type a = h(key, tab.d);
+    if (a < tab.nextToSplit) a = h(key, tab.d+1);
 
-    for (size_type i {0}; i < table[a]->currentBucketSize; ++i)
-    {
-      if(key_equal{}(table[a]->contents[i], key)) return i;
-    }
+    int i = tab.table[a]->index(key, depth(a));
+    if(i != -1) return i;
 
-    Bucket* currentBucket = table[a];
+    Bucket* currentBucket = tab.table[a];
 
     while (!(currentBucket->overflowBucket == nullptr))
     {
       currentBucket = currentBucket->overflowBucket;
-      for (size_type i {0}; i < currentBucket->currentBucketSize; ++i)
-      {
-        if(key_equal{}(currentBucket->contents[i], key)) return i;
-      }
+      i = currentBucket->index(key, depth(a));
+      if(i != -1) return i;
   }
   // nothing was found
   return -1;
@@ -388,24 +866,19 @@ public:
   int find_row(const key_type &key) const 
   {
     if(numElements == 0) return -1; // error
+    if(inlineMode) return -1; // inline elements are not stored in a row
 
-    size_type a = h(key, d);
-    if (a < nextToSplit) a = h(key, d+1);
+    size_type a = h(key, tab.d);
+    if (a < tab.nextToSplit) a = h(key, tab.d+1);
 
-    for (size_type i {0}; i < table[a]->currentBucketSize; ++i)
-    {
-      if(key_equal{}(table[a]->contents[i], key)) return a;
-    }
+    if(tab.table[a]->index(key, depth(a)) != -1) return a;
 
-    Bucket* currentBucket = table[a];
+    Bucket* currentBucket = tab.table[a];
 
     while (currentBucket->overflowBucket != nullptr)
     {
       currentBucket = currentBucket->overflowBucket;
-      for (size_type i {0}; i < currentBucket->currentBucketSize; ++i)
-      {
-        if(key_equal{}(currentBucket->contents[i], key)) return a;
-      }
+      if(currentBucket->index(key, depth(a)) != -1) return a;
   }
   // nothing was found
   return -1;
@@ -416,21 +889,30 @@ public:
   {
     if(lhs.size() != rhs.size()) return false;
 
-    for(size_type a {0}; a < lhs.currentTableSize; ++a)
+    if(lhs.inlineMode)
     {
-      for (size_type i {0}; i < lhs.table[a]->currentBucketSize; ++i)
+      for(size_type i {0}; i < lhs.numElements; ++i)
       {
-        if(!rhs.count(lhs.table[a]->contents[i])) return false;
+        if(!rhs.count(lhs.inlineContents[i])) return false;
       }
+      return true;
+    }
 
-      Bucket* currentBucket = lhs.table[a];
+    for(size_type a {0}; a < lhs.tab.currentTableSize; ++a)
+    {
+      for (size_type i {0}; i < lhs.tab.table[a]->currentBucketSize; ++i)
+      {
+        if(!rhs.count(lhs.tab.table[a]->get(i, a, lhs.depth(a)))) return false;
+      }
+
+      Bucket* currentBucket = lhs.tab.table[a];
 
       while (currentBucket->overflowBucket != nullptr)
       {
         currentBucket = currentBucket->overflowBucket;
         for (size_type i {0}; i < currentBucket->currentBucketSize; ++i)
         {
-          if(!rhs.count(currentBucket->contents[i])) return false;
+          if(!rhs.count(currentBucket->get(i, a, lhs.depth(a)))) return false;
         }
       }
     }
@@ -444,6 +926,7 @@ public:
   }
 
   // (in)equality operators for Bucket
+  // the Buckets are compared as Buckets of the same row, so compact Buckets compare their quotients
   friend bool operator==(const Bucket &lhs, const Bucket &rhs)
   {
     if (lhs.currentBucketSize != rhs.currentBucketSize) return false;
@@ -451,7 +934,7 @@ public:
 
     for (size_type i {0}; i < lhs.currentBucketSize; i++)
     {
-      if(std::not_equal_to(lhs.contents[i], rhs.contents[i])) return false;
+      if(std::not_equal_to(lhs.get(i, 0, 0), rhs.get(i, 0, 0))) return false;
     }
 
     if(lhs.overflowBucket == nullptr && rhs.overflowBucket == nullptr) return true;
@@ -463,7 +946,7 @@ public:
     {
       for (size_type i {0}; i < currentBucketLhs->currentBucketSize; i++)
       {
-        if(std::not_equal_to(currentBucketLhs->contents[i], currentBucketRhs->contents[i])) return false;
+        if(std::not_equal_to(currentBucketLhs->get(i, 0, 0), currentBucketRhs->get(i, 0, 0))) return false;
       }
 
       currentBucketLhs = currentBucketLhs->overflowBucket;
@@ -485,166 +968,222 @@ public:
 // this function does not check whether the key is already present
 // it is called by the various insert functions after the necessary
 // checks have been made, so no duplicates are inserted
-template <typename Key, size_t N>
-typename ADS_set<Key,N>::Bucket *ADS_set<Key,N>::insert_(const key_type &key)
+template <typename Key, size_t N, bool Compact, bool Prefilter>
+typename ADS_set<Key,N,Compact,Prefilter>::Bucket *ADS_set<Key,N,Compact,Prefilter>::insert_(const key_type &key)
 {
-  size_type a = h(key, d);
-  if (a < nextToSplit) a = h(key, d+1);
+  // small set, store the element inline as long as there is room
+  if (inlineMode)
+  {
+    if (numElements < inlineCapacity)
+    {
+      new (inlineContents+numElements) key_type(key);
+      return nullptr;
+    }
+    spill();
+  }
 
-  // table completely empty
-  if (currentTableSize == 0)
+  own_table();
+
+  // bounded-latency mode: carry out the scheduled splits before this insertion schedules new ones
+  // if maintain() did not grow the table in time and it is almost full, it is grown instead,
+  // so the splits don't have to reallocate it
+  if(splitBudget > 0)
   {
-    rehash();
-    table[a]->contents[table[a]->currentBucketSize++] = key;
-    if(nextToSplit == (1ul<<d))
-    { 
-      ++d;
-      nextToSplit = 0;
-    };
-    return table[a];
+    if(tab.allocSize - tab.currentTableSize <= tab.currentTableSize/8) grow();
+    else split_pending(splitBudget);
   }
 
-  Bucket* currentBucket = table[a];
+  size_type a = h(key, tab.d);
+  if (a < tab.nextToSplit) a = h(key, tab.d+1);
+
+  own_row(a);
+  Bucket* currentBucket = tab.table[a];
+  if constexpr (prefilter) tab.table[a]->filter_add(filter_hash(key));
+  size_type chainLength {1};
 
   // has overflow bucket and the current bucket is full
-  while(currentBucket->overflowBucket != nullptr && currentBucket->currentBucketSize == N) 
+  while(currentBucket->overflowBucket != nullptr && !currentBucket->accepts(key, depth(a))) 
   {
     currentBucket = currentBucket->overflowBucket;
+    ++chainLength;
   }
 
   // overflow bucket at end is full
   // nowhere left to insert the element, need to rehash the table
-  if(currentBucket->currentBucketSize == N && currentBucket->overflowBucket == nullptr) 
+  if(!currentBucket->accepts(key, depth(a)) && currentBucket->overflowBucket == nullptr) 
   {
     currentBucket->overflowBucket = new Bucket;
     currentBucket = currentBucket->overflowBucket;
-    currentBucket->contents[currentBucket->currentBucketSize++] = key;
-    if(allocSize >= currentTableSize+1) {
-      rehash_noalloc();
-    } else
-    {
-      rehash();
-    }
-
-    if(nextToSplit == (1ul<<d))
-    { 
-      ++d;
-      nextToSplit = 0;
-    };
+    currentBucket->push(key, depth(a));
+    ++chainLength;
+    // row is too long, split it rather than the next row
+    if(maxChain > 0 && chainLength > maxChain) split_row(a);
+    split_or_schedule();
 
-    return table[a];
+    return tab.table[a];
   }
 
-  currentBucket->contents[currentBucket->currentBucketSize++] = key;
+  currentBucket->push(key, depth(a));
 
-  return table[a];
+  // row is too long, split it (unless splits are already scheduled)
+  if(maxChain > 0 && tab.pendingSplits == 0)
+  {
+    while(currentBucket->overflowBucket != nullptr)
+    {
+      currentBucket = currentBucket->overflowBucket;
+      ++chainLength;
+    }
+    if(chainLength > maxChain) split_row(a);
+  }
+
+  return tab.table[a];
 }
 
 // Help function that inserts a key into the table
 // never calls rehash
-template <typename Key, size_t N>
-typename ADS_set<Key,N>::Bucket *ADS_set<Key,N>::insert_noexcept(const key_type &key)
+template <typename Key, size_t N, bool Compact, bool Prefilter>
+typename ADS_set<Key,N,Compact,Prefilter>::Bucket *ADS_set<Key,N,Compact,Prefilter>::insert_noexcept(const key_type &key)
 {
-  size_type a = h(key, d);
-  if (a < nextToSplit) a = h(key, d+1);
+  size_type a = h(key, tab.d);
+  if (a < tab.nextToSplit) a = h(key, tab.d+1);
 
-  Bucket* currentBucket = table[a];
+  Bucket* currentBucket = tab.table[a];
+  if constexpr (prefilter) tab.table[a]->filter_add(filter_hash(key));
 
   // move to first empty bucket or the last bucket
-  while(currentBucket->overflowBucket != nullptr && currentBucket->currentBucketSize == N) 
+  while(currentBucket->overflowBucket != nullptr && !currentBucket->accepts(key, depth(a))) 
   {
     currentBucket = currentBucket->overflowBucket;
   }
 
   // bucket is full
-  if(currentBucket->currentBucketSize == N && currentBucket->overflowBucket == nullptr) 
+  if(!currentBucket->accepts(key, depth(a)) && currentBucket->overflowBucket == nullptr) 
   {
     currentBucket->overflowBucket = new Bucket;
     currentBucket = currentBucket->overflowBucket;
-    currentBucket->contents[currentBucket->currentBucketSize++] = key;
+    currentBucket->push(key, depth(a));
 
-    return table[a];
+    return tab.table[a];
   }  
   // Bucket not full
-  currentBucket->contents[currentBucket->currentBucketSize++] = key;
-  return table[a];
+  currentBucket->push(key, depth(a));
+  return tab.table[a];
 }
 
-// Help function that finds the first Bucket of the row in which the key is saved
-template <typename Key, size_t N>
-typename ADS_set<Key,N>::Bucket *ADS_set<Key,N>::find_(const key_type &key) const
+// Help function that moves the inline elements into the table
+// called once the inline storage is full, the table is created
+// with a single row which can hold all inline elements (inlineCapacity <= N)
+// the inline storage shares its memory with the table variables, so the
+// elements are moved out before the table variables are constructed
+template <typename Key, size_t N, bool Compact, bool Prefilter>
+void ADS_set<Key,N,Compact,Prefilter>::spill()
 {
-  if(numElements == 0 || currentTableSize == 0) return nullptr;
+  std::vector<key_type> vals(inlineContents, inlineContents+numElements);
+  for (size_type i {0}; i < numElements; ++i)
+  {
+    inlineContents[i].~key_type();
+  }
 
-  size_type a = h(key, d);
-  if (a < nextToSplit) a = h(key, d+1);
+  inlineMode = false;
+  new (&tab) TableVars {}; // all table variables zero, the table is created by rehash()
 
-  for (size_type i {0}; i < table[a]->currentBucketSize; ++i)
+  rehash();
+  for (auto elem : vals)
   {
-    if(key_equal{}(table[a]->contents[i], key)) return table[a];
+    insert_noexcept(elem);
   }
+}
 
-  Bucket* currentBucket = table[a];
+// Help function that finds the position of the key in the inline storage
+// returns -1 if the key is not stored inline
+template <typename Key, size_t N, bool Compact, bool Prefilter>
+int ADS_set<Key,N,Compact,Prefilter>::find_inline(const key_type &key) const
+{
+  if(!inlineMode) return -1;
+
+  for (size_type i {0}; i < numElements; ++i)
+  {
+    if(key_equal{}(inlineContents[i], key)) return i;
+  }
+  // nothing was found
+  return -1;
+}
+
+// Help function that finds the first Bucket of the row in which the key is saved
+template <typename Key, size_t N, bool Compact, bool Prefilter>
+typename ADS_set<Key,N,Compact,Prefilter>::Bucket *ADS_set<Key,N,Compact,Prefilter>::find_(const key_type &key) const
+{
+  if(numElements == 0 || rows() == 0) return nullptr;
+
+  size_type a = h(key, tab.d);
+  if (a < tab.nextToSplit) a = h(key, tab.d+1);
+  if (!may_contain(a, key)) return nullptr;
+
+  if(tab.table[a]->index(key, depth(a)) != -1) return tab.table[a];
+
+  Bucket* currentBucket = tab.table[a];
 
   while (currentBucket->overflowBucket != nullptr)
   {
     currentBucket = currentBucket->overflowBucket;
-    for (size_type i {0}; i < currentBucket->currentBucketSize; ++i)
-    {
-      if(key_equal{}(currentBucket->contents[i], key)) return table[a];
-    }
+    if(currentBucket->index(key, depth(a)) != -1) return tab.table[a];
   }
   // nothing was found
   return nullptr;
 }
 
 // Help function that finds the Bucket of the row in which the key is saved
-template <typename Key, size_t N>
-typename ADS_set<Key,N>::Bucket *ADS_set<Key,N>::find_ofb(const key_type &key) const
+template <typename Key, size_t N, bool Compact, bool Prefilter>
+typename ADS_set<Key,N,Compact,Prefilter>::Bucket *ADS_set<Key,N,Compact,Prefilter>::find_ofb(const key_type &key) const
 {
-  if(numElements == 0) return nullptr;
+  if(numElements == 0 || inlineMode) return nullptr;
 
-  size_type a = h(key, d);
-  if (a < nextToSplit) a = h(key, d+1);
+  size_type a = h(key, tab.d);
+  if (a < tab.nextToSplit) a = h(key, tab.d+1);
+  if (!may_contain(a, key)) return nullptr;
 
-  for (size_type i {0}; i < table[a]->currentBucketSize; ++i)
-  {
-    if(key_equal{}(table[a]->contents[i], key)) return table[a];
-  }
+  if(tab.table[a]->index(key, depth(a)) != -1) return tab.table[a];
 
-  Bucket* currentBucket = table[a];
+  Bucket* currentBucket = tab.table[a];
 
   while (currentBucket->overflowBucket != nullptr)
   {
     currentBucket = currentBucket->overflowBucket;
-    for (size_type i {0}; i < currentBucket->currentBucketSize; ++i)
-    {
-      if(key_equal{}(currentBucket->contents[i], key)) return currentBucket;
-    }
+    if(currentBucket->index(key, depth(a)) != -1) return currentBucket;
   }
   // nothing was found
   return nullptr;
 }
 
 // Dump function to print information about the ADS_set to the specified ostream
-template <typename Key, size_t N>
-void ADS_set<Key,N>::dump(std::ostream &o) const {
+template <typename Key, size_t N, bool Compact, bool Prefilter>
+void ADS_set<Key,N,Compact,Prefilter>::dump(std::ostream &o) const {
   o << "Num Elements: " << numElements << std::endl;
-  o << "Table Size: " << currentTableSize << std::endl;
-  o << "Alloc Size: " << allocSize << std::endl;
-  o << "d: " << d << std::endl;
-  o << "nextToSplit is: " << nextToSplit << std::endl;
-  for (size_type i{0}; i < currentTableSize; ++i) {
+  if (inlineMode) {
+    o << "Inline: ";
+    for (size_type i{0}; i < numElements; ++i) {
+      o << inlineContents[i] << " ";
+    }
+    o << std::endl;
+    o << "End of Dump." << std::endl;
+    return;
+  }
+  o << "Table Size: " << tab.currentTableSize << std::endl;
+  o << "Alloc Size: " << tab.allocSize << std::endl;
+  o << "d: " << tab.d << std::endl;
+  o << "nextToSplit is: " << tab.nextToSplit << std::endl;
+  o << "Pending splits: " << tab.pendingSplits << std::endl;
+  for (size_type i{0}; i < tab.currentTableSize; ++i) {
     o << "Bucket " << i << ": ";
-    for (size_type j{0}; j < table[i]->currentBucketSize; ++j) {
-      o << table[i]->contents[j] << " ";
+    for (size_type j{0}; j < tab.table[i]->currentBucketSize; ++j) {
+      o << tab.table[i]->get(j, i, depth(i)) << " ";
     }
   
-    if(table[i]->overflowBucket != nullptr){
+    if(tab.table[i]->overflowBucket != nullptr){
       o << "Overflow Bucket 1: ";
-      Bucket* currentBucket = table[i]->overflowBucket;
+      Bucket* currentBucket = tab.table[i]->overflowBucket;
       for(size_type j{0}; j < currentBucket->currentBucketSize; ++j){
-          o << currentBucket->contents[j] << " ";
+          o << currentBucket->get(j, i, depth(i)) << " ";
       }
 
       int nBucket {2};
@@ -652,7 +1191,7 @@ void ADS_set<Key,N>::dump(std::ostream &o) const {
         o << "Overflow Bucket " << nBucket++ << ": ";
         //Bucket* currentBucket = currentBucket->overflowBucket;
         for(size_type j{0}; j < currentBucket->overflowBucket->currentBucketSize; ++j){
-          o << currentBucket->overflowBucket->contents[j] << " ";
+          o << currentBucket->overflowBucket->get(j, i, depth(i)) << " ";
         }
   
         currentBucket = currentBucket->overflowBucket;
@@ -665,16 +1204,19 @@ void ADS_set<Key,N>::dump(std::ostream &o) const {
 }
 
 // Iterator class for the ADS_set
-template <typename Key, size_t N>
-class ADS_set<Key,N>::Iterator {
+template <typename Key, size_t N, bool Compact, bool Prefilter>
+class ADS_set<Key,N,Compact,Prefilter>::Iterator {
 public:
   using value_type = Key;
   using difference_type = std::ptrdiff_t;
-  using reference = const value_type &;
+  // keys of compact Buckets are decoded, there is no stored key to refer to,
+  // so the iterator returns them by value and is only an input iterator
+  using reference = std::conditional_t<compact, value_type, const value_type &>;
   using pointer = const value_type *;
-  using iterator_category = std::forward_iterator_tag;
+  using iterator_category = std::conditional_t<compact, std::input_iterator_tag, std::forward_iterator_tag>;
 private:
   const key_type* elem;
+  std::conditional_t<compact, key_type, char> value; // decoded key, used when elem is nullptr (compact Buckets)
   Bucket* currentBucket;
   int arrIndex;
   int elemIndex;
@@ -689,6 +1231,10 @@ public:
     currentBucket = cBckt;
     elemIndex = eleIdx;
     arrIndex = arrIdx;
+    if constexpr (compact)
+    {
+      if(elem == nullptr && currentBucket != nullptr) value = currentBucket->get(elemIndex, arrIndex, set->depth(arrIndex));
+    }
   }
 
   explicit Iterator(const ADS_set* set)
@@ -696,7 +1242,7 @@ public:
     this->set = set;
     this->elem = nullptr;
     this->currentBucket = nullptr;
-    this->arrIndex = set->currentTableSize;
+    this->arrIndex = set->rows();
     this->elemIndex = -1;
   }
 
@@ -713,30 +1259,57 @@ public:
   {
     this->elem = nullptr;
     this->currentBucket = nullptr;
-    this->arrIndex = set->currentTableSize;
+    this->arrIndex = set->rows();
     this->elemIndex = -1;
   }
 
   // access operators
-  reference operator*() const { return *elem; }
-  pointer operator->() { return elem; } const
+  reference operator*() const 
+  { 
+    if constexpr (compact)
+    {
+      if(elem == nullptr) return value;
+    }
+    return *elem; 
+  }
+  pointer operator->() 
+  { 
+    if constexpr (compact)
+    {
+      if(elem == nullptr) return &value; // valid as long as the iterator is not changed
+    }
+    return elem; 
+  } const
 
   // Functions to advance the iterator
   Iterator &operator++() 
   {
     if(this->set == nullptr) return *this;
     ++elemIndex;
+
+    // inline elements of a small set, the table variables must not be read
+    if(set->inlineMode)
+    {
+      if(static_cast<size_type>(elemIndex) == set->numElements)
+      {
+        // end reached
+        invalidate();
+        return *this;
+      }
+      elem = set->inlineContents+elemIndex;
+      return *this;
+    }
     while(currentBucket->currentBucketSize == static_cast<size_type>(elemIndex)){ //find next bucket with element
         if (currentBucket->overflowBucket == nullptr) //last overflowBucket
         {
-          if(static_cast<size_type>(arrIndex+1) == set->currentTableSize)
+          if(static_cast<size_type>(arrIndex+1) == set->tab.currentTableSize)
           {
             // end reached
             invalidate();
             return *this;
           }
           ++arrIndex;
-          currentBucket = set->table[arrIndex];
+          currentBucket = set->tab.table[arrIndex];
         } else
         {
           currentBucket = currentBucket->overflowBucket;
@@ -744,7 +1317,8 @@ public:
         elemIndex = 0;
     }
     
-    elem = currentBucket->contents+elemIndex;
+    elem = currentBucket->slot(elemIndex);
+    if constexpr (compact) value = currentBucket->get(elemIndex, arrIndex, set->depth(arrIndex));
     return *this;
   }
 
@@ -766,7 +1340,31 @@ public:
   }
 };
 
+// Read-only view of an ADS_set, returned by snapshot()
+// holds a copy of the ADS_set (sharing its table), but only offers the const operations
+template <typename Key, size_t N, bool Compact, bool Prefilter>
+class ADS_set<Key,N,Compact,Prefilter>::Snapshot {
+public:
+  using value_type = Key;
+  using key_type = Key;
+  using size_type = size_t;
+  using iterator = typename ADS_set::const_iterator;
+  using const_iterator = typename ADS_set::const_iterator;
+private:
+  ADS_set set;
+public:
+  explicit Snapshot(const ADS_set &set) : set {set} {}
+
+  size_type size() const { return set.size(); }
+  bool empty() const { return set.empty(); }
+  size_type count(const key_type &key) const { return set.count(key); }
+  const_iterator find(const key_type &key) const { return set.find(key); }
+  const_iterator begin() const { return set.begin(); }
+  const_iterator end() const { return set.end(); }
+  void dump(std::ostream &o = std::cerr) const { set.dump(o); }
+};
+
 // swaps two ADS_sets
-template <typename Key, size_t N> void swap(ADS_set<Key,N> &lhs, ADS_set<Key,N> &rhs) { lhs.swap(rhs); }
+template <typename Key, size_t N, bool Compact, bool Prefilter> void swap(ADS_set<Key,N,Compact,Prefilter> &lhs, ADS_set<Key,N,Compact,Prefilter> &rhs) { lhs.swap(rhs); }
 
 #endif // ADS_SET_H
\ No newline at end of file